@@ -2,6 +2,8 @@ VERSION = 1.0
 
 DEFINES += SMARTCOMPLETIONPLUGIN_LIBRARY
 
+QT += concurrent
+
 # SmartCompletionPlugin files
 
 SOURCES += smartcompletionpluginplugin.cpp
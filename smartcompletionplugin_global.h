@@ -2,8 +2,14 @@
 #define SMARTCOMPLETIONPLUGIN_GLOBAL_H
 
 #include <QtGlobal>
+#include <QAtomicInt>
 #include <QRegularExpression>
 #include <QDebug>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
 
 #if defined(SMARTCOMPLETIONPLUGIN_LIBRARY)
 #  define SMARTCOMPLETIONPLUGINSHARED_EXPORT Q_DECL_EXPORT
@@ -19,6 +25,15 @@
 #define STR_PROPERTY LS("Q_PROPERTY")
 #define STR_CLASS LS("class")
 
+/// deepest '<' and ',' nesting getVaildTypeName follows
+#define TYPE_NAME_MAX_DEPTH 256
+
+/// codeToBlocks lexes on one core unless end_position is at least this far in.
+/// not measured yet, tune it with the timings test/test.cpp prints.
+#define PARALLEL_LEX_MIN_SIZE (1 << 20)
+/// chars lexRange lexes between two looks at its cancel flag
+#define LEX_CANCEL_CHECK_INTERVAL (1 << 16)
+
 class Global
 {
 public:
@@ -37,6 +52,12 @@ public:
         CommentedOutLine
     };
 
+    /// lexer state at a line start
+    enum LexState{
+        CodeState,
+        CommentedOutBlockState
+    };
+
     struct CodeInfo{
         WordType type;
         QString word;
@@ -48,6 +69,25 @@ public:
         int length = 0;
     };
 
+    /// lexRange input and output
+    struct LexTask{
+        const QString *code = nullptr;
+        int from = 0;
+        int to = 0;
+        /// stop before the first non-code block starting here
+        int endPosition = 0;
+        LexState state = CodeState;
+        int beginPosition = 0;
+        /// position lexing stopped at, -1 if it stopped at endPosition
+        int stop = 0;
+        QList<Block> blocks;
+        /// stop as soon as a non-code block equals one of these, and set mergeIndex to it
+        const QList<Block> *mergeBlocks = nullptr;
+        int mergeIndex = -1;
+        /// stop with stop = -1 once this is set
+        const QAtomicInt *canceled = nullptr;
+    };
+
     struct Property{
         QString type;
         QString name;
@@ -74,8 +114,20 @@ public:
         return str.mid(block.fromPosition, block.length);
     }
 
-    /// split into blocks of c++ code.
-    static QList<Block> codeToBlocks(const QString &code, int end_position = -1);
+    /// split into blocks of c++ code. the list is incomplete once *canceled is set.
+    static QList<Block> codeToBlocks(const QString &code, int end_position = -1,
+                                     const QAtomicInt *canceled = nullptr);
+    static QList<Block> codeToBlocksSequential(const QString &code, int end_position = -1,
+                                               const QAtomicInt *canceled = nullptr);
+    /// same result as codeToBlocksSequential, but lex line aligned chunks on all cores.
+    static QList<Block> codeToBlocksParallel(const QString &code, int end_position = -1,
+                                             int chunk_count = 0,
+                                             const QAtomicInt *canceled = nullptr);
+    /// first line start after position that is not a string continuation, or the end.
+    static int lineStartAfter(const QString &code, int position);
+    /// lex code in [task.from, task.to) starting in task.state.
+    static void lexRange(LexTask &task);
+    static bool mergeLexTask(LexTask &task);
     static int getBlockByPosition(const QList<Block> &list, int current_position);
     /// skip commented out and empty char
     static QString prevSymbolByPosition(const QString &code,
@@ -89,12 +141,20 @@ public:
     static QString getSymbolByPosition(const QString &text, int position,
                                        int *start_pos = nullptr, int *end_pos = nullptr);
     /// parse qt code, get cursor position code type(such as type is property or class defind)
-    static CodeInfo codeParse(const QString &str, int cursor_position);
+    static CodeInfo codeParse(const QString &str, int cursor_position,
+                              const QAtomicInt *canceled = nullptr);
     /// parse Q_PROPERTY code. get property type&value name&get fun name&set fun name|signal name...
     static bool propertyParse(const QString &str, Property &property);
     /// get vaild c++ type name(such as QList<int*>*) from current position.
     static QString getVaildTypeName(const QString &code, int from_position,
                                     int *start_pos = nullptr, int *end_pos = nullptr);
+    /// check a type name from offset, build it into type_name when not null.
+    /// fails beyond TYPE_NAME_MAX_DEPTH nested '<' and ',' so the recursion stays bounded.
+    static bool parseVaildTypeName(const QString &code, const QRegularExpression &rx, int offset,
+                                   int *start_pos, int *end_pos, QString *type_name,
+                                   int depth = 0);
+    /// first position from "from" that is not ' ', or -1.
+    static int indexOfNotSpace(const QString &code, int from);
 };
 
 QDebug operator<<(QDebug deg, const Global::Block &block)
@@ -124,17 +184,243 @@ QDebug operator<<(QDebug deg, const Global::Property &property)
     return deg;
 }
 
-QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position)
+QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position,
+                                          const QAtomicInt *canceled)
 {
     if(end_position == -1)
         end_position = code.count();
 
-    int i = -1;
-    int begin_pos = 0;
+    if(end_position >= PARALLEL_LEX_MIN_SIZE && QThread::idealThreadCount() > 1)
+        return codeToBlocksParallel(code, end_position, 0, canceled);
+
+    return codeToBlocksSequential(code, end_position, canceled);
+}
+
+QList<Global::Block> Global::codeToBlocksSequential(const QString &code, int end_position,
+                                                    const QAtomicInt *canceled)
+{
+    LexTask task;
+
+    task.code = &code;
+    task.canceled = canceled;
+    task.to = code.count();
+    task.endPosition = end_position == -1 ? code.count() : end_position;
+
+    lexRange(task);
+
+    if(task.stop < 0)
+        return task.blocks;/// return
+
+    task.blocks << createBlock(CodeBlock, task.beginPosition, task.stop - task.beginPosition);
+
+    return task.blocks;
+}
+
+QList<Global::Block> Global::codeToBlocksParallel(const QString &code, int end_position,
+                                                  int chunk_count, const QAtomicInt *canceled)
+{
+    if(end_position == -1)
+        end_position = code.count();
+
+    if(chunk_count <= 0)
+        chunk_count = QThread::idealThreadCount();
+
+    /// lex in parallel up to the line after end_position, the rest runs on sequentially
+    /// and stops at the first non-code block, like codeToBlocksSequential.
+    int split = lineStartAfter(code, end_position);
+    int chunk_size = split / qMax(chunk_count, 1) + 1;
+    QList<int> bounds;
+
+    bounds << 0;
+
+    for(int pos = chunk_size; pos < split; pos += chunk_size) {
+        int bound = lineStartAfter(code, qMax(pos, bounds.last()));
+
+        if(bound >= split)
+            break;
+
+        if(bound > bounds.last())
+            bounds << bound;
+    }
+
+    bounds << split;
+
+    /// at a line start the lexer is in code or inside a block comment. lex every chunk
+    /// from code first, then from inside a comment until it meets the code result.
+    QVector<LexTask> code_tasks;
+    QVector<LexTask> comment_tasks;
+
+    for(int k = 0; k < bounds.count() - 1; ++k) {
+        LexTask task;
+
+        task.code = &code;
+        task.from = bounds.at(k);
+        task.to = bounds.at(k + 1);
+        task.endPosition = task.to;
+        task.beginPosition = task.from;
+        task.canceled = canceled;
+        code_tasks << task;
+    }
+
+    QtConcurrent::blockingMap(code_tasks, &Global::lexRange);
+
+    if(canceled && canceled->load())
+        return QList<Block>();
+
+    for(int k = 1; k < code_tasks.count(); ++k) {
+        LexTask task = code_tasks.at(k);
+
+        task.state = CommentedOutBlockState;
+        task.beginPosition = task.from;
+        task.blocks.clear();
+        task.mergeBlocks = &code_tasks.at(k).blocks;
+        comment_tasks << task;
+    }
+
+    QtConcurrent::blockingMap(comment_tasks, &Global::lexRange);
+
+    if(canceled && canceled->load())
+        return QList<Block>();
+
+    /// stitch: pick each chunk's result by the state the previous one ended in,
+    /// and extend its first block back to where it really began.
+    LexTask result;
+
+    result.code = &code;
+    result.endPosition = end_position;
+    result.canceled = canceled;
+
+    for(int k = 0; k < code_tasks.count(); ++k) {
+        const LexTask &code_task = code_tasks.at(k);
+        const LexTask &task = result.state == CodeState ? code_task : comment_tasks.at(k - 1);
+        const LexTask &end_task = task.mergeIndex < 0 ? task : code_task;
+        QList<Block> blocks = task.blocks;
+
+        if(task.mergeIndex >= 0)
+            blocks << code_task.blocks.mid(task.mergeIndex + 1);
+
+        if(!blocks.isEmpty()) {
+            Block &first = blocks.first();
+
+            first.length += first.fromPosition - result.beginPosition;
+            first.fromPosition = result.beginPosition;
+
+            result.blocks << blocks;
+            result.beginPosition = end_task.beginPosition;
+        }
+
+        result.state = end_task.state;
+        result.stop = end_task.stop;
+    }
+
+    /// cut where sequential lexing returns: before the first non-code block at end_position
+    for(int i = 0; i < result.blocks.count(); ++i) {
+        const Block &block = result.blocks.at(i);
+
+        if(block.type != CodeBlock && block.fromPosition >= end_position)
+            return result.blocks.mid(0, i);
+    }
+
+    if(result.state == CommentedOutBlockState && result.beginPosition >= end_position)
+        return result.blocks;
+
+    if(split < code.count()) {
+        result.from = split;
+        result.to = code.count();
+
+        lexRange(result);
+
+        if(result.stop < 0)
+            return result.blocks;
+    }
+
+    result.blocks << createBlock(CodeBlock, result.beginPosition,
+                                 result.stop - result.beginPosition);
+
+    return result.blocks;
+}
+
+int Global::lineStartAfter(const QString &code, int position)
+{
+    /// a string may continue over a backslash-newline, so skip those lines
+    int j = code.indexOf(LC('\n'), position);
+
+    while(j > 0 && code.at(j - 1) == LC('\\'))
+        j = code.indexOf(LC('\n'), j + 1);
 
-    QList<Block> blocks;
+    if(j < 0 || j + 1 >= code.count())
+        return code.count();
+
+    return j + 1;
+}
+
+bool Global::mergeLexTask(LexTask &task)
+{
+    if(!task.mergeBlocks)
+        return false;
+
+    const Block &block = task.blocks.last();
+    const QList<Block> &list = *task.mergeBlocks;
+
+    int i = std::lower_bound(list.constBegin(), list.constEnd(), block.fromPosition,
+                             [](const Block &b, int from) {
+        return b.fromPosition < from;
+    }) - list.constBegin();
+
+    for(; i < list.count() && list.at(i).fromPosition == block.fromPosition; ++i) {
+        if(list.at(i).type == block.type && list.at(i).length == block.length) {
+            task.mergeIndex = i;
+            task.stop = task.to;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Global::lexRange(LexTask &task)
+{
+    const QString &code = *task.code;
+    const int to = task.to;
+    QList<Block> &blocks = task.blocks;
+    int &begin_pos = task.beginPosition;
+    int i = task.from - 1;
+    int next_cancel_check = i;
+
+    if(task.state == CommentedOutBlockState) {
+        int j = code.midRef(task.from, to - task.from).indexOf(LS("*/"));
+
+        if(j < 0) {
+            if(to < code.count()) {
+                task.stop = to;/// still inside the comment
+                return;
+            }
+
+            j = code.count() - 1;
+        } else {
+            j += task.from + 1;
+        }
+
+        blocks << createBlock(CommentedOutBlock, begin_pos, j - begin_pos + 1);
+        task.state = CodeState;
+        i = j;
+        begin_pos = j + 1;
+
+        if(mergeLexTask(task))
+            return;
+    }
+
+    while(++i < to) {
+        if(task.canceled && i >= next_cancel_check) {
+            if(task.canceled->load()) {
+                task.stop = -1;
+                return;
+            }
+
+            next_cancel_check = i + LEX_CANCEL_CHECK_INTERVAL;
+        }
 
-    while(++i < code.count()) {
         QChar ch = code.at(i);
 
         switch (ch.toLatin1()) {
@@ -142,13 +428,14 @@ QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position)
         case '\"':{
             blocks << createBlock(CodeBlock, begin_pos, i - begin_pos);
 
-            if(i >= end_position) {
-                return blocks;/// return
+            if(i >= task.endPosition) {
+                task.stop = -1;
+                return;/// return
             }
 
             int j = i;
 
-            while(++j < code.count()) {
+            while(++j < to) {
                 switch (code.at(j).toLatin1()) {
                 case '"':{
                     if(ch != LC('"'))
@@ -176,6 +463,9 @@ QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position)
             blocks << createBlock((ch == LC('"') ? StringBlock : CharBlock), i, j - i + 1);
             i = j;
             begin_pos = j + 1;
+
+            if(mergeLexTask(task))
+                return;
             break;
         }
         case '/':{
@@ -185,21 +475,32 @@ QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position)
             if(next_ch == LC('*')) {
                 blocks << createBlock(CodeBlock, begin_pos, i - begin_pos);
 
-                if(i >= end_position) {
-                    return blocks;/// return
+                if(i >= task.endPosition) {
+                    task.stop = -1;
+                    return;/// return
                 }
 
-                j = code.indexOf(LS("*/"), i + 2);
+                j = code.midRef(i + 2, to - i - 2).indexOf(LS("*/"));
+
+                if(j < 0) {
+                    if(to < code.count()) {
+                        /// closed in a later range
+                        task.state = CommentedOutBlockState;
+                        begin_pos = i;
+                        task.stop = to;
+                        return;
+                    }
 
-                if(j < 0)
                     j = code.count() - 1;
-                else
-                    ++j;
+                } else {
+                    j += i + 2 + 1;
+                }
             } else if(next_ch == LC('/')) {
                 blocks << createBlock(CodeBlock, begin_pos, i - begin_pos);
 
-                if(i >= end_position) {
-                    return blocks;/// return
+                if(i >= task.endPosition) {
+                    task.stop = -1;
+                    return;/// return
                 }
 
                 j = code.indexOf(LC('\n'), i + 2);
@@ -213,6 +514,9 @@ QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position)
             blocks << createBlock((next_ch == LC('/') ? CommentedOutLine : CommentedOutBlock), i, j - i + 1);
             i = j;
             begin_pos = j + 1;
+
+            if(mergeLexTask(task))
+                return;
             break;
         }
         case '\\':{
@@ -227,9 +531,7 @@ QList<Global::Block> Global::codeToBlocks(const QString &code, int end_position)
         }
     }
 
-    blocks << createBlock(CodeBlock, begin_pos, i - begin_pos);
-
-    return blocks;
+    task.stop = i;
 }
 
 int Global::getBlockByPosition(const QList<Block> &list, int current_position)
@@ -250,10 +552,15 @@ QString Global::prevSymbolByPosition(const QString &code,
                                      int current_position)
 {
     QRegularExpression not_word_rx(LS("\\S\\s"));
-    QString tmp_str;
+    /// first char of the code after the current block, positions past it were searched before
+    QString next_str;
+    int length = 0;
 
     int index = getBlockByPosition(list, current_position);
 
+    if(index < 0)
+        return LS("");
+
     const Block &block = list.at(index);
 
     int pos_offset = block.length - current_position + block.fromPosition;
@@ -262,12 +569,21 @@ QString Global::prevSymbolByPosition(const QString &code,
         const Block &block = list.at(index);
 
         if(block.type == CodeBlock) {
-            tmp_str = getStrByBlock(code, block) + tmp_str;
+            const QString &str = getStrByBlock(code, block);
 
-            int pos = tmp_str.lastIndexOf(not_word_rx, qMax(tmp_str.count() - pos_offset - 1, 0));
+            length += str.count();
 
-            if(pos >= 0) {
-                return getSymbolByPosition(tmp_str, pos);
+            if(!str.isEmpty()) {
+                const QString &tmp_str = str + next_str;
+
+                int pos = tmp_str.lastIndexOf(not_word_rx, qMin(qMax(length - pos_offset - 1, 0),
+                                                                str.count() - 1));
+
+                if(pos >= 0) {
+                    return getSymbolByPosition(tmp_str, pos);
+                }
+
+                next_str = str.left(1);
             }
         } else if(block.type != CommentedOutBlock
                   && block.type != CommentedOutLine) {
@@ -287,6 +603,9 @@ QString Global::nextSymbolByPosition(const QString &code,
 
     int index = getBlockByPosition(list, current_position);
 
+    if(index < 0)
+        return LS("");
+
     const Block &block = list.at(index);
 
     int pos_offset = current_position - block.fromPosition;
@@ -347,12 +666,16 @@ QString Global::getSymbolByPosition(const QString &code, int current_position,
     return LS("");
 }
 
-Global::CodeInfo Global::codeParse(const QString &str, int cursor_position)
+Global::CodeInfo Global::codeParse(const QString &str, int cursor_position,
+                                   const QAtomicInt *canceled)
 {
     if(str.isEmpty())
         return CodeInfo{UnknowType, LS("")};
 
-    const QList<Block> &blocks = codeToBlocks(str, cursor_position);
+    const QList<Block> &blocks = codeToBlocks(str, cursor_position, canceled);
+
+    if(canceled && canceled->load())
+        return CodeInfo{UnknowType, LS("")};
     const Block block = blocks.last();
 
     if(block.type != CodeBlock)
@@ -413,11 +736,19 @@ bool Global::propertyParse(const QString &str, Global::Property &property)
 QString Global::getVaildTypeName(const QString &code, int offset, int *start_pos, int *end_pos)
 {
     QString typeName;
+    QRegularExpression rx(LS(RX_SYMBOL));
 
-    if(offset < 0)
-        return typeName;
+    if(!parseVaildTypeName(code, rx, offset, start_pos, end_pos, &typeName))
+        return LS("");
 
-    QRegularExpression rx(LS(RX_SYMBOL));
+    return typeName;
+}
+
+bool Global::parseVaildTypeName(const QString &code, const QRegularExpression &rx, int offset,
+                                int *start_pos, int *end_pos, QString *type_name, int depth)
+{
+    if(offset < 0 || depth > TYPE_NAME_MAX_DEPTH)
+        return false;
 
     const QRegularExpressionMatch &match = rx.match(code, offset);
 
@@ -425,11 +756,13 @@ QString Global::getVaildTypeName(const QString &code, int offset, int *start_pos
         if(start_pos)
             *start_pos = match.capturedStart();
 
+        if(match.capturedLength() <= 0)
+            return false;
+
         offset = match.capturedEnd() - 1;
-        typeName = match.captured();
 
-        if(typeName.isEmpty())
-            return typeName;
+        if(type_name)
+            *type_name = match.captured();
 
         while(++offset < code.length()) {
             const QChar &ch = code.at(offset);
@@ -437,46 +770,50 @@ QString Global::getVaildTypeName(const QString &code, int offset, int *start_pos
             switch (ch.toLatin1()) {
             case ' ':/// intentional
             case '*':
-                typeName.append(ch);
+                if(type_name)
+                    type_name->append(ch);
                 break;
             case ':':
-                if(offset >= code.length() || code.at(++offset) != LC(':')) {
-                    return LS("");
+                if(++offset >= code.length() || code.at(offset) != LC(':')) {
+                    return false;
                 }
-                typeName.append(ch);
+                if(type_name)
+                    type_name->append(ch);
                 /// intentional
             case ',':/// intentional
             case '<':{
-                typeName.append(ch);
+                if(type_name)
+                    type_name->append(ch);
 
-                int endPos = code.indexOf(QRegularExpression(LS("[^ ]")), offset + 1);
+                int endPos = indexOfNotSpace(code, offset + 1);
 
-                const QString &str = getVaildTypeName(code, endPos, nullptr, &endPos);
-
-                if(!str.isEmpty()) {
+                /// nested levels only check, the text is copied once here
+                if(parseVaildTypeName(code, rx, endPos, nullptr, &endPos, nullptr, depth + 1)) {
                     if(endPos < code.length())
-                        endPos = code.indexOf(QRegularExpression(LS("[^ ]")), endPos);
+                        endPos = indexOfNotSpace(code, endPos);
 
                     if(endPos > 0) {
                         if(ch != LC('<')) {
                             --endPos;
                         } else if(endPos >= code.length() || code.at(endPos) != LC('>')) {
-                            return LS("");
+                            return false;
                         }
 
-                        typeName.append(code.mid(offset + 1, endPos - offset));
+                        if(type_name)
+                            type_name->append(code.mid(offset + 1, endPos - offset));
+
                         offset = endPos;
                         break;
                     }
                 }
 
-                return LS("");
+                return false;
             }
             default:
                 if(end_pos)
                     *end_pos = offset;
 
-                return typeName;
+                return true;
             }
         }
     }
@@ -484,7 +821,17 @@ QString Global::getVaildTypeName(const QString &code, int offset, int *start_pos
     if(end_pos)
         *end_pos = offset;
 
-    return typeName;
+    return true;
+}
+
+int Global::indexOfNotSpace(const QString &code, int from)
+{
+    for(int i = qMax(from, 0); i < code.length(); ++i) {
+        if(code.at(i) != LC(' '))
+            return i;
+    }
+
+    return -1;
 }
 
 #endif // SMARTCOMPLETIONPLUGIN_GLOBAL_H
@@ -17,10 +17,36 @@
 #include <QMenu>
 #include <QPlainTextEdit>
 #include <QTextBlock>
+#include <QTextDocument>
 #include <QRegularExpression>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <QtPlugin>
 
+namespace SmartCompletionPlugin {
+namespace Internal {
+
+/// one background codeParse, and the text snapshot it runs on.
+class ParseJob
+{
+public:
+    QFutureWatcher<Global::CodeInfo> watcher;
+    QPointer<QPlainTextEdit> editor;
+    QString text;
+    int cursorPosition = 0;
+    int revision = 0;
+    /// set to stop the running parse early
+    QAtomicInt canceled;
+    /// parse again once the canceled one has finished
+    bool restart = false;
+};
+
+} // namespace Internal
+} // namespace SmartCompletionPlugin
+
 using namespace SmartCompletionPlugin::Internal;
 
 SmartCompletionPluginPlugin::SmartCompletionPluginPlugin()
@@ -32,6 +58,7 @@ SmartCompletionPluginPlugin::~SmartCompletionPluginPlugin()
 {
     // Unregister objects from the plugin manager's object pool
     // Delete members
+    delete m_parseJob;
 }
 
 bool SmartCompletionPluginPlugin::initialize(const QStringList &arguments, QString *errorString)
@@ -46,6 +73,7 @@ bool SmartCompletionPluginPlugin::initialize(const QStringList &arguments, QStri
     Q_UNUSED(arguments)
     Q_UNUSED(errorString)
 
+    /// only cheap registration here, anything heavy is created on first use.
     QAction *action = new QAction(tr("SmartCompletionPlugin action"), this);
     Core::Command *cmd = Core::ActionManager::registerAction(action, Constants::ACTION_ID,
                                                              Core::Context(Core::Constants::C_GLOBAL));
@@ -72,10 +100,28 @@ ExtensionSystem::IPlugin::ShutdownFlag SmartCompletionPluginPlugin::aboutToShutd
     // Save settings
     // Disconnect from signals that are not needed during shutdown
     // Hide UI (if you add UI that is not in the main window directly)
-    return SynchronousShutdown;
+    if (!m_parseJob || m_parseJob->watcher.isFinished())
+        return SynchronousShutdown;
+
+    /// stop the running parse, and don't touch the editor again when it returns.
+    disconnect(&m_parseJob->watcher, SIGNAL(finished()), this, SLOT(parseFinished()));
+    connect(&m_parseJob->watcher, SIGNAL(finished()), this, SIGNAL(asynchronousShutdownFinished()));
+    m_parseJob->canceled.store(1);
+
+    return AsynchronousShutdown;
+}
+
+ParseJob *SmartCompletionPluginPlugin::parseJob()
+{
+    if (!m_parseJob) {
+        m_parseJob = new ParseJob;
+        connect(&m_parseJob->watcher, SIGNAL(finished()), this, SLOT(parseFinished()));
+    }
+
+    return m_parseJob;
 }
 
-void SmartCompletionPluginPlugin::triggerAction() const
+void SmartCompletionPluginPlugin::triggerAction()
 {
     const Core::EditorManager *editorManager = Core::EditorManager::instance();
 
@@ -97,14 +143,46 @@ void SmartCompletionPluginPlugin::triggerAction() const
     if (!textEditor)
         return;
 
-    const QString &text = textEditor->toPlainText();
-    int cursor_position = textEditor->textCursor().position();
+    ParseJob *job = parseJob();
+
+    /// one parse at a time: triggering again while it runs cancels it and parses anew
+    /// once it has returned.
+    if (job->watcher.isRunning()) {
+        job->canceled.store(1);
+        job->restart = true;
+        return;
+    }
+
+    job->editor = textEditor;
+    job->text = textEditor->toPlainText();
+    job->cursorPosition = textEditor->textCursor().position();
+    job->revision = textEditor->document()->revision();
+    job->canceled.store(0);
+    job->watcher.setFuture(QtConcurrent::run(&Global::codeParse, job->text,
+                                             job->cursorPosition, &job->canceled));
+}
+
+void SmartCompletionPluginPlugin::parseFinished()
+{
+    QPlainTextEdit *textEditor = m_parseJob->editor.data();
+
+    m_parseJob->editor.clear();
+
+    if (m_parseJob->restart) {
+        m_parseJob->restart = false;
+        triggerAction();
+        return;
+    }
+
+    /// the result is stale once the user has edited the document.
+    if (!textEditor || textEditor->document()->revision() != m_parseJob->revision)
+        return;
 
-    Global::CodeInfo symbol = Global::codeParse(text, cursor_position);
+    const Global::CodeInfo symbol = m_parseJob->watcher.result();
 
     switch (symbol.type) {
     case Global::PropertyType:
-        completionProperty(textEditor);
+        completionProperty(m_parseJob->text, m_parseJob->cursorPosition);
         break;
     default:
         break;
@@ -115,12 +193,11 @@ void SmartCompletionPluginPlugin::triggerAction() const
                              symbol.word + LS(" ") + QString::number(symbol.word.length()));
 }
 
-void SmartCompletionPluginPlugin::completionProperty(QPlainTextEdit *editor) const
+void SmartCompletionPluginPlugin::completionProperty(const QString &text, int cursor_position) const
 {
     QRegularExpression rx(LS(".+"));
 
-    const QRegularExpressionMatch &match = rx.match(editor->toPlainText(),
-                                                    editor->textCursor().position());
+    const QRegularExpressionMatch &match = rx.match(text, cursor_position);
 
     if(match.isValid()) {
         Global::Property property;
@@ -3,11 +3,11 @@
 
 #include <extensionsystem/iplugin.h>
 
-class QPlainTextEdit;
-
 namespace SmartCompletionPlugin {
 namespace Internal {
 
+class ParseJob;
+
 class SmartCompletionPluginPlugin : public ExtensionSystem::IPlugin
 {
     Q_OBJECT
@@ -22,11 +22,16 @@ public:
     ShutdownFlag aboutToShutdown();
 
 private slots:
-    void triggerAction() const;
+    void triggerAction();
+    void parseFinished();
 
 private:
+    /// create the parse worker on first use, keep it out of IDE startup.
+    ParseJob *parseJob();
     /// completion macro:Q_PROPERTY
-    void completionProperty(QPlainTextEdit *editor) const;
+    void completionProperty(const QString &text, int cursor_position) const;
+
+    ParseJob *m_parseJob = nullptr;
 };
 
 } // namespace Internal
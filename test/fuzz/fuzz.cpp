@@ -0,0 +1,176 @@
+#include <QDebug>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <sanitizer/allocator_interface.h>
+
+#include "../../smartcompletionplugin_global.h"
+
+/// time budget of one call is TIME_BASE + TIME_FACTOR * scan * input size, where scan is the
+/// per-byte time of copying and scanning a buffer, calibrated once at startup. the scan is not
+/// under test, so a slower lexer or parser does not raise its own budget. linear paths do a
+/// few passes that each cost more per byte than the scan, TIME_FACTOR leaves room for that.
+/// a path doing n^2 scan-sized steps goes over roughly once n^2 * scan > TIME_BASE and
+/// n > TIME_FACTOR, so both constants bound the smallest input a quadratic path is caught on.
+/// time is thread CPU time, so load on the machine does not count against the call.
+#define TIME_BASE_NS 1000000
+#define TIME_FACTOR 1000
+/// allocation budget of one call is ALLOC_BASE + ALLOC_PER_BYTE * input size.
+/// the UTF-16 text is 2 bytes per input byte, a block per input byte at most is ~32 bytes in
+/// the QList, and the parsers copy the text a few times. the base covers the regexes.
+#define ALLOC_BASE_BYTES (1 << 20)
+#define ALLOC_PER_BYTE_BYTES 128
+
+static qint64 time_base_ns = TIME_BASE_NS;
+static qint64 time_factor = TIME_FACTOR;
+static double scan_ns_per_byte = 0;
+static qint64 alloc_base_bytes = ALLOC_BASE_BYTES;
+static qint64 alloc_per_byte_bytes = ALLOC_PER_BYTE_BYTES;
+
+static std::atomic<qint64> allocated_bytes(0);
+
+static void mallocHook(const volatile void *ptr, size_t size)
+{
+    Q_UNUSED(ptr)
+
+    allocated_bytes += size;
+}
+
+static void freeHook(const volatile void *ptr)
+{
+    Q_UNUSED(ptr)
+}
+
+static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    /// codeParse prints to qDebug on every call
+    Q_UNUSED(type)
+    Q_UNUSED(context)
+    Q_UNUSED(msg)
+}
+
+static qint64 envValue(const char *name, qint64 default_value)
+{
+    bool ok = false;
+    qint64 value = qgetenv(name).toLongLong(&ok);
+
+    return ok ? value : default_value;
+}
+
+static qint64 threadTimeNs()
+{
+    timespec time;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+
+    return qint64(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+template <typename Func>
+static qint64 measureNs(Func func)
+{
+    qint64 begin = threadTimeNs();
+
+    func();
+
+    return threadTimeNs() - begin;
+}
+
+static double calibrateScanNsPerByte()
+{
+    const int size = 1 << 20;
+    const QString buffer(size, LC('a'));
+    qint64 best = -1;
+
+    /// best of five, the first run also warms up the allocator
+    for(int i = 0; i < 5; ++i) {
+        qint64 time = measureNs([&] {
+            QString copy = buffer;
+
+            copy.detach();
+
+            volatile int count = copy.count(LC(' '));
+            Q_UNUSED(count)
+        });
+
+        if(best < 0 || time < best)
+            best = time;
+    }
+
+    return double(best) / size;
+}
+
+template <typename Func>
+static void checkBudget(const char *name, size_t size, Func func)
+{
+    allocated_bytes = 0;
+
+    qint64 time = measureNs(func);
+    qint64 bytes = allocated_bytes;
+    qint64 time_budget = time_base_ns + qint64(time_factor * scan_ns_per_byte * size);
+    qint64 alloc_budget = alloc_base_bytes + alloc_per_byte_bytes * qint64(size);
+
+    if(time > time_budget) {
+        fprintf(stderr, "%s: %lld ns over budget of %lld ns for %zu bytes\n",
+                name, time, time_budget, size);
+        abort();
+    }
+
+    if(bytes > alloc_budget) {
+        fprintf(stderr, "%s: allocated %lld bytes over budget of %lld bytes for %zu bytes\n",
+                name, bytes, alloc_budget, size);
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    Q_UNUSED(argc)
+    Q_UNUSED(argv)
+
+    time_base_ns = envValue("SMARTCOMPLETION_FUZZ_TIME_BASE_NS", TIME_BASE_NS);
+    time_factor = envValue("SMARTCOMPLETION_FUZZ_TIME_FACTOR", TIME_FACTOR);
+    alloc_base_bytes = envValue("SMARTCOMPLETION_FUZZ_ALLOC_BASE", ALLOC_BASE_BYTES);
+    alloc_per_byte_bytes = envValue("SMARTCOMPLETION_FUZZ_ALLOC_PER_BYTE", ALLOC_PER_BYTE_BYTES);
+
+    qInstallMessageHandler(messageHandler);
+    __sanitizer_install_malloc_and_free_hooks(mallocHook, freeHook);
+
+    scan_ns_per_byte = calibrateScanNsPerByte();
+
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const QString text = QString::fromUtf8(reinterpret_cast<const char *>(data), int(size));
+
+    /// cursor at the first '@', else in the middle
+    int cursor_position = text.indexOf(LC('@'));
+
+    if(cursor_position < 0)
+        cursor_position = text.count() / 2;
+
+    checkBudget("codeToBlocks", size, [&] {
+        Global::codeToBlocks(text);
+    });
+
+    checkBudget("codeParse", size, [&] {
+        Global::codeParse(text, cursor_position);
+    });
+
+    checkBudget("propertyParse", size, [&] {
+        Global::Property property;
+
+        Global::propertyParse(text, property);
+    });
+
+    checkBudget("getVaildTypeName", size, [&] {
+        Global::getVaildTypeName(text, 0);
+    });
+
+    return 0;
+}
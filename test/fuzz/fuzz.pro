@@ -0,0 +1,23 @@
+QT += core concurrent
+QT -= gui
+
+TARGET = fuzz-plugin
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+## libFuzzer needs clang. run the corpus with: ./fuzz-plugin corpus/*
+## or fuzz with: ./fuzz-plugin new_corpus corpus
+## corpus holds the known slow and crashing shapes. their sizes are estimates for the old
+## quadratic code, shrink them with -merge=1 or -minimize_crash against that code.
+## budgets are tuned with the SMARTCOMPLETION_FUZZ_* environment variables, see fuzz.cpp
+QMAKE_CC = clang
+QMAKE_CXX = clang++
+QMAKE_LINK = clang++
+QMAKE_CXXFLAGS += -fsanitize=fuzzer,address -g
+QMAKE_LFLAGS += -fsanitize=fuzzer,address
+
+SOURCES += fuzz.cpp
+
+HEADERS += ../../smartcompletionplugin_global.h
@@ -1,12 +1,29 @@
 #include <QCoreApplication>
 #include <QFile>
 #include <QDebug>
+#include <QElapsedTimer>
 
 #include "../smartcompletionplugin_global.h"
 class CookieJar;
 class QNetworkAccessManager;
 class Tower : public QObject
 {};
+
+static bool sameBlocks(const QList<Global::Block> &list1, const QList<Global::Block> &list2)
+{
+    if(list1.count() != list2.count())
+        return false;
+
+    for(int i = 0; i < list1.count(); ++i) {
+        if(list1.at(i).type != list2.at(i).type
+                || list1.at(i).fromPosition != list2.at(i).fromPosition
+                || list1.at(i).length != list2.at(i).length)
+            return false;
+    }
+
+    return true;
+}
+
 int main()
 {
     //QCoreApplication a(argv, args);
@@ -33,5 +50,41 @@ int main()
 
     //qDebug() << Global::getVaildTypeName("QList::q <  int::a<b>::nn * >::bbb  *      aaa*", 0);//
 
+    QString code;
+
+    for(int i = 0; i < 20000; ++i)
+        code += LS("int a = 0; /* x\n \"y\" */ s = \"a\\\n b\"; // c\nchar c = '\\''; /*\n\n*/\n");
+
+    QElapsedTimer timer;
+
+    timer.start();
+    const QList<Global::Block> &blocks = Global::codeToBlocksSequential(code);
+    qDebug() << "sequential lex:" << timer.nsecsElapsed() / 1000 << "us";
+
+    bool same = true;
+    const QList<int> chunk_counts = QList<int>() << 1 << 2 << 4 << QThread::idealThreadCount();
+
+    for(int chunk_count : chunk_counts) {
+        timer.restart();
+        const QList<Global::Block> &parallel_blocks = Global::codeToBlocksParallel(code, -1, chunk_count);
+        qDebug() << "parallel lex," << chunk_count << "chunks:" << timer.nsecsElapsed() / 1000 << "us";
+
+        same = same && sameBlocks(blocks, parallel_blocks);
+    }
+
+    for(int cursor_position : QList<int>() << 0 << code.count() / 3 << code.count() / 2) {
+        const QList<Global::Block> &cursor_blocks = Global::codeToBlocksSequential(code, cursor_position);
+
+        for(int chunk_count : chunk_counts) {
+            same = same && sameBlocks(cursor_blocks,
+                                      Global::codeToBlocksParallel(code, cursor_position, chunk_count));
+        }
+    }
+
+    qDebug() << "parallel lex same as sequential:" << same;
+
+    if(!same)
+        return 1;
+
     return 0;
 }
@@ -1,4 +1,4 @@
-QT += core
+QT += core concurrent
 QT -= gui
 
 TARGET = test-plugin